@@ -3,6 +3,7 @@
 
 #include "VehicleMovementComponent.h"
 #include "VehiclePawn.h"
+#include "VehicleTelemetry.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Components/StaticMeshComponent.h"
 
@@ -18,11 +19,73 @@ void UVehicleMovementComponent::BeginPlay()
 
     VehiclePawn = Cast<AVehiclePawn>(GetOwner());
     VehicleMeshComp = VehiclePawn->GetStaticMeshComponent();
+
+    TelemetryId = FVehicleTelemetry::Get().RegisterVehicle(VehiclePawn->GetName());
+}
+
+void UVehicleMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+    FVehicleTelemetry::Get().UnregisterVehicle(TelemetryId);
+
+    Super::EndPlay(EndPlayReason);
 }
 
 void UVehicleMovementComponent::TickComponent(float DeltaTime, enum ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
     Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+    if (FVehicleTelemetry::Get().IsRecording())
+    {
+        RecordTelemetry();
+    }
+}
+
+void UVehicleMovementComponent::RecordTelemetry()
+{
+    if (!VehiclePawn)
+    {
+        return;
+    }
+
+    // only re-check the filter when it changes
+    uint32 FilterSerial = FVehicleTelemetry::GetFilterSerial();
+    if (TelemetryFilterSerial != FilterSerial)
+    {
+        TelemetryFilterSerial = FilterSerial;
+        bPassesTelemetryFilter = FVehicleTelemetry::PassesFilter(VehiclePawn->GetName());
+    }
+    if (!bPassesTelemetryFilter)
+    {
+        return;
+    }
+
+    double Time = GetWorld()->GetTimeSeconds();
+    double Interval = FVehicleTelemetry::GetSampleInterval();
+    if (LastTelemetryTime >= 0.0 && Time < LastTelemetryTime + Interval)
+    {
+        return;
+    }
+    // advance by the interval so frame time rounding doesn't lower the rate, but never fall more than one interval behind
+    LastTelemetryTime = (LastTelemetryTime >= 0.0) ? FMath::Max(LastTelemetryTime + Interval, Time - Interval) : Time;
+
+    FVehicleTelemetrySample Sample;
+    Sample.Time = Time;
+    Sample.VehicleId = TelemetryId;
+    Sample.Speed = VehiclePawn->GetVelocity().Size();
+    Sample.Throttle = LastThrottle;
+    Sample.Angle = LastAngle;
+    Sample.ObstacleDistance = VehiclePawn->ObstacleDistance;
+    for (int32 i = 0; i < 4; i++)
+    {
+        Sample.SuspensionCompression[i] = VehiclePawn->GetSuspensionCompression(i);
+    }
+    Sample.Flags = (bIsDrifting ? VTF_Drifting : 0)
+        | (bIsHandbraking ? VTF_Handbraking : 0)
+        | (VehiclePawn->bIsBlocked ? VTF_Blocked : 0)
+        | (VehiclePawn->IsGrounded() ? VTF_Grounded : 0)
+        | (VehiclePawn->bIsAI ? VTF_AI : 0);
+
+    FVehicleTelemetry::Get().Push(Sample);
 }
 
 void UVehicleMovementComponent::RequestDirectMove(const FVector& MoveVelocity, bool bForceMaxSpeed)
@@ -88,6 +151,7 @@ void UVehicleMovementComponent::RequestPathMove(const FVector& MoveInput)
 void UVehicleMovementComponent::ThrottleVehicle(float AxisValue)
 {
     //TODO: Do not move if the car is tipped over
+    LastThrottle = AxisValue;
 	FVector ForceForward = FVector::ZeroVector;
 	AccForce = (VehiclePawn->IsGrounded()) ? GroundAccForce * AxisValue : AirAccForce * AxisValue;
     Timer = (AxisValue == 0) ? 0.0f : Timer;
@@ -155,6 +219,7 @@ void UVehicleMovementComponent::HandbrakeVehicle(bool bIsHandbrake)
 
 void UVehicleMovementComponent::TurnVehicle(float Angle)
 {
+    LastAngle = Angle;
     float RightVelocity = FVector::DotProduct(VehicleMeshComp->GetRightVector(), VehicleMeshComp->GetComponentVelocity());
 	float ForwardVelocity = VehicleMeshComp->GetPhysicsLinearVelocity().Size();
 
@@ -23,6 +23,11 @@ class RL_POSTPERSON_API UVehicleMovementComponent : public UPawnMovementComponen
 	
 	virtual void RequestPathMove(const FVector& MoveInput) override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	/** Push the current state of the vehicle to the telemetry channel if it is due for a sample */
+	void RecordTelemetry();
+
 public:
 
 protected:
@@ -49,6 +54,18 @@ protected:
 	bool bIsAccelerating = false;
 	/** Keep track in how long the vehicle has will stop */
 	float TimeToStop;
+	/** Last throttle axis value applied, recorded by telemetry */
+	float LastThrottle = 0.0f;
+	/** Last turning angle applied, recorded by telemetry */
+	float LastAngle = 0.0f;
+	/** World time the last telemetry sample was due at */
+	double LastTelemetryTime = -1.0;
+	/** Id of this vehicle in the telemetry samples */
+	uint32 TelemetryId = 0;
+	/** Cached result of the telemetry vehicle filter */
+	bool bPassesTelemetryFilter = false;
+	/** Filter serial bPassesTelemetryFilter was computed with */
+	uint32 TelemetryFilterSerial = MAX_uint32;
 
 	/** Acceleration force to apply to the vehicle when on the ground */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Movement")
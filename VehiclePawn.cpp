@@ -7,19 +7,29 @@
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "AIController.h"
+#include "Navigation/PathFollowingComponent.h"
 #include "VehicleMovementComponent.h"
 #include "CollisionShape.h"
 #include "CollisionQueryParams.h"
 #include "TrafficPath.h"
+#include "Net/UnrealNetwork.h"
+#include "VehiclePerceptionSubsystem.h"
 
 // Sets default values
 AVehiclePawn::AVehiclePawn()
 {
  	// Set this pawn to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
+	bReplicates = true;
 
 	VehicleMesh = CreateDefaultSubobject<UStaticMeshComponent>(TEXT("VehicleMesh"));
 	VehicleMesh->SetupAttachment(RootComponent);
+#if UE_SERVER
+	// the mesh is only kept for collision and physics on a dedicated server
+	VehicleMesh->SetVisibility(false);
+	VehicleMesh->SetCastShadow(false);
+	VehicleMesh->bReceivesDecals = false;
+#endif
 
 	Wheel_FL = CreateDefaultSubobject<USceneComponent>(TEXT("Wheel_FL"));
 	Wheel_FL->SetupAttachment(VehicleMesh);
@@ -45,11 +55,19 @@ void AVehiclePawn::BeginPlay()
 {
 	Super::BeginPlay();
 
-	if(!bIsAI)
+	// steer straight ahead until the owning client sends where it is aiming, proxies already have the replicated value
+	if (HasAuthority())
+	{
+		AimDirection = GetActorForwardVector();
+	}
+
+#if !UE_SERVER
+	// input and the mouse cursor only exist for local players
+	if(!bIsAI && !IsRunningDedicatedServer())
 	{
 		PlayerController = Cast<APlayerController>(UGameplayStatics::GetPlayerController(GetWorld(), 0));
 
-		if (PlayerController != nullptr)
+		if (PlayerController != nullptr && PlayerController->IsLocalController())
 		{
 			if (UEnhancedInputLocalPlayerSubsystem* Subsystem = ULocalPlayer::GetSubsystem<UEnhancedInputLocalPlayerSubsystem>(PlayerController->GetLocalPlayer()))
 			{
@@ -59,6 +77,7 @@ void AVehiclePawn::BeginPlay()
 			PlayerController->bShowMouseCursor = true;
 		}
 	}
+#endif
 
 	RayCastLocations.Add(Wheel_FL);
 	RayCastLocations.Add(Wheel_FR);
@@ -68,6 +87,26 @@ void AVehiclePawn::BeginPlay()
 	VehicleMesh->SetLinearDamping(LinearDamper);
 	VehicleMesh->SetAngularDamping(AngularDamper);
 
+	if(bIsAI)
+	{
+		PerceptionSubsystem = GetWorld()->GetSubsystem<UVehiclePerceptionSubsystem>();
+		if (PerceptionSubsystem)
+		{
+			PerceptionSubsystem->RegisterVehicle(this);
+		}
+	}
+}
+
+// Called when the game ends or when destroyed
+void AVehiclePawn::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (PerceptionSubsystem)
+	{
+		PerceptionSubsystem->UnregisterVehicle(this);
+		PerceptionSubsystem = nullptr;
+	}
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -91,6 +130,7 @@ void AVehiclePawn::Tick(float DeltaTime)
 		if (HitResult.bBlockingHit)
 		{
 			float Compression = HitResult.Distance / WheelSize;
+			SuspensionCompression[i] = Compression;
 			// impact normal
 			GroundNormal = (HitResult.Normal);
 
@@ -107,6 +147,7 @@ void AVehiclePawn::Tick(float DeltaTime)
 		}
 		else
 		{
+			SuspensionCompression[i] = 1.0f;
 			FloorNonContactCount++;
 
 			if (FloorNonContactCount == 4)
@@ -117,71 +158,40 @@ void AVehiclePawn::Tick(float DeltaTime)
 	}	
 	if(bIsAI)
 	{
-		APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(GetWorld(), 0);
-		AAIController* AIController = Cast<AAIController>(GetController());
-		FCollisionShape Shape = FCollisionShape::MakeBox(VehicleCollision->GetScaledBoxExtent());
-		FHitResult HitResult;
-		FCollisionQueryParams Params(TEXT("Trace"), true, this);
-		bIsBlocked = false;
-		
-		// check if the player is close to the vehicle
-		if(PlayerPawn && PlayerPawn->GetVelocity().Size() < 20 && FVector::Dist(PlayerPawn->GetActorLocation(), GetActorLocation()) < 400.0f)
-			bIsCloseToPlayer = true;
-		else
-			bIsCloseToPlayer = false;
-
-		// box trace to check if the vehicle is blocked by an obstacle
-		GetWorld()->SweepSingleByChannel(HitResult,VehicleCollision->GetComponentLocation() , VehicleCollision->GetComponentLocation() + GetActorForwardVector() * DistanceThreshold, GetActorRotation().Quaternion(), ECC_Visibility, Shape, Params);
-		// check if the vehicle is blocked by anything that is not the player and is not breakable
-		if (HitResult.bBlockingHit && (HitResult.GetActor() != PlayerPawn || !bIsChasing) && !HitResult.GetActor()->ActorHasTag("Breakable") && !bIsCloseToPlayer)
+		// the perception scheduler updates AI vehicles under a frame budget, in between we extrapolate
+		if (PerceptionSubsystem)
 		{
-			ObstacleDistance = HitResult.Distance;
-			bIsBlocked = true;
-			// check if the vehicle is close enough needs to brake or can overtake
-			bHasToBrake = (HitResult.GetActor()->GetVelocity().Size() < 500) ? true : false;
+			ExtrapolatePerception(DeltaTime);
 
-			if (HitResult.GetActor()->IsA(AVehiclePawn::StaticClass()))
+			// reached the look-ahead point before the next update, don't coast until the scheduler gets to us
+			AAIController* AIController = Cast<AAIController>(GetController());
+			if (bIsFollowingPath && AIController && AIController->GetMoveStatus() == EPathFollowingStatus::Idle)
 			{
-				bIsVehicle = true;
-				// check angle between vehicle and obstacle velocity vectors
-				FRotator Hitrotation = HitResult.GetActor()->GetVelocity().GetSafeNormal().Rotation();
-				FRotator VehicleRotation = VehicleMesh->GetForwardVector().Rotation();
-				FRotator FinalRotation = UKismetMathLibrary::NormalizedDeltaRotator(Hitrotation, VehicleRotation);
-
-				float Angle = FinalRotation.Yaw;
-				// Depending on the angle between the vehicle and the obstacle, the vehicle will have to brake brake
-				if (Angle > 50 && Angle < 130 || Angle < -50 && Angle > -130)
-				{
-					bHasToBrake = true;
-				}
-				// check if the vehicle is moving at the same speed or slower than the obstacle to check if it is trully blocked
-				else if(HitResult.GetActor()->GetVelocity().Size() >= this->GetVelocity().Size() && HitResult.Distance > 10.0f)
-				{
-					bIsBlocked = false;
-				}	
+				bIsFollowingPath = false;
+				PerceptionSubsystem->RequestUpdate(this);
 			}
-			else
-				bIsVehicle = false;
-			
-		}
-		// if vehicle is not chasing player then it is following the path
-		if(!bIsChasing && CarPath)
-		{
-			FVector ForwardVector = CarPath->PathSpline->FindDirectionClosestToWorldLocation(GetActorLocation(), ESplineCoordinateSpace::World);
-			FVector NextPoint = CarPath->PathSpline->FindLocationClosestToWorldLocation(GetActorLocation() + ForwardVector * AIPathResolution, ESplineCoordinateSpace::World);
-
-			AIController->MoveToLocation(NextPoint, 50.0f, false, true, true, false, 0, true);
 		}
+		else
+			UpdatePerception();
 	}
 	// not an AI so the player controlls the steering of the vehicle
 	else
 	{
-		FVector WorldLocation;
-		FVector WorldDirection;
-		// get mouse position in world
-		PlayerController->DeprojectMousePositionToWorld(WorldLocation, WorldDirection);
-		// get the rotation to look at the mouse position
-		FRotator TargetRotation = WorldDirection.Rotation();
+#if !UE_SERVER
+		// only the owning player has a mouse, everyone else uses the replicated aim direction
+		if (IsLocallyControlled() && PlayerController)
+		{
+			FVector WorldLocation;
+			FVector WorldDirection;
+			// get mouse position in world
+			if (PlayerController->DeprojectMousePositionToWorld(WorldLocation, WorldDirection))
+			{
+				UpdateAimDirection(WorldDirection, DeltaTime);
+			}
+		}
+#endif
+		// get the rotation to look at the aim direction
+		FRotator TargetRotation = AimDirection.Rotation();
 		FRotator Rotation = UKismetMathLibrary::NormalizedDeltaRotator(TargetRotation, GetActorRotation());
 		// turn the vehicle
 		VehicleMovementComponent->TurnVehicle(Rotation.Yaw);
@@ -226,7 +236,132 @@ void AVehiclePawn::JumpVehicle(const FInputActionValue& Value)
 	}
 }
 
+void AVehiclePawn::UpdatePerception(float UpdateInterval)
+{
+	APawn* PlayerPawn = UGameplayStatics::GetPlayerPawn(GetWorld(), 0);
+	AAIController* AIController = Cast<AAIController>(GetController());
+	FCollisionShape Shape = FCollisionShape::MakeBox(VehicleCollision->GetScaledBoxExtent());
+	FHitResult HitResult;
+	FCollisionQueryParams Params(TEXT("Trace"), true, this);
+	bIsBlocked = false;
+	bHasObstacle = false;
+	bObstacleBlocks = false;
+	ObstacleVelocity = FVector::ZeroVector;
+	// sweep further than the threshold by the distance we travel before the next update, so extrapolation has something to close in on
+	float SweepDistance = DistanceThreshold + GetVelocity().Size() * UpdateInterval;
+	
+	// check if the player is close to the vehicle
+	if(PlayerPawn && PlayerPawn->GetVelocity().Size() < 20 && FVector::Dist(PlayerPawn->GetActorLocation(), GetActorLocation()) < 400.0f)
+		bIsCloseToPlayer = true;
+	else
+		bIsCloseToPlayer = false;
+
+	// box trace to check if the vehicle is blocked by an obstacle
+	GetWorld()->SweepSingleByChannel(HitResult,VehicleCollision->GetComponentLocation() , VehicleCollision->GetComponentLocation() + GetActorForwardVector() * SweepDistance, GetActorRotation().Quaternion(), ECC_Visibility, Shape, Params);
+	// check if the vehicle is blocked by anything that is not the player and is not breakable
+	if (HitResult.bBlockingHit && (HitResult.GetActor() != PlayerPawn || !bIsChasing) && !HitResult.GetActor()->ActorHasTag("Breakable") && !bIsCloseToPlayer)
+	{
+		ObstacleDistance = HitResult.Distance;
+		ObstacleVelocity = HitResult.GetActor()->GetVelocity();
+		bHasObstacle = true;
+		bObstacleBlocks = true;
+		// check if the vehicle is close enough needs to brake or can overtake
+		bHasToBrake = (HitResult.GetActor()->GetVelocity().Size() < 500) ? true : false;
+
+		if (HitResult.GetActor()->IsA(AVehiclePawn::StaticClass()))
+		{
+			bIsVehicle = true;
+			// check angle between vehicle and obstacle velocity vectors
+			FRotator Hitrotation = HitResult.GetActor()->GetVelocity().GetSafeNormal().Rotation();
+			FRotator VehicleRotation = VehicleMesh->GetForwardVector().Rotation();
+			FRotator FinalRotation = UKismetMathLibrary::NormalizedDeltaRotator(Hitrotation, VehicleRotation);
+
+			float Angle = FinalRotation.Yaw;
+			// Depending on the angle between the vehicle and the obstacle, the vehicle will have to brake brake
+			if (Angle > 50 && Angle < 130 || Angle < -50 && Angle > -130)
+			{
+				bHasToBrake = true;
+			}
+			// check if the vehicle is moving at the same speed or slower than the obstacle to check if it is trully blocked
+			else if(HitResult.GetActor()->GetVelocity().Size() >= this->GetVelocity().Size() && HitResult.Distance > 10.0f)
+			{
+				bObstacleBlocks = false;
+			}	
+		}
+		else
+			bIsVehicle = false;
+		
+		// obstacles past the threshold are only cached for extrapolation
+		bIsBlocked = bObstacleBlocks && ObstacleDistance <= DistanceThreshold;
+	}
+	bIsFollowingPath = false;
+	// if vehicle is not chasing player then it is following the path
+	if(!bIsChasing && CarPath)
+	{
+		FVector ForwardVector = CarPath->PathSpline->FindDirectionClosestToWorldLocation(GetActorLocation(), ESplineCoordinateSpace::World);
+		// look further ahead the longer we go without an update so the point isn't reached before the next one
+		float LookAheadDistance = AIPathResolution + GetVelocity().Size() * UpdateInterval;
+		FVector NextPoint = CarPath->PathSpline->FindLocationClosestToWorldLocation(GetActorLocation() + ForwardVector * LookAheadDistance, ESplineCoordinateSpace::World);
+
+		if (AIController)
+		{
+			// a point we are already at finishes straight away, only ask for an early update after a real move
+			bIsFollowingPath = AIController->MoveToLocation(NextPoint, 50.0f, false, true, true, false, 0, true) == EPathFollowingRequestResult::RequestSuccessful;
+		}
+	}
+}
+
+void AVehiclePawn::ExtrapolatePerception(float DeltaTime)
+{
+	if (!bHasObstacle)
+	{
+		return;
+	}
+
+	// close the cached distance by how fast we are approaching the obstacle since the last sweep
+	float ClosingSpeed = FVector::DotProduct(GetVelocity() - ObstacleVelocity, GetActorForwardVector());
+	ObstacleDistance = FMath::Max(ObstacleDistance - ClosingSpeed * DeltaTime, 0.0f);
+
+	// blocked once the obstacle comes within range, unblocked if it moves out of it
+	bIsBlocked = bObstacleBlocks && ObstacleDistance <= DistanceThreshold;
+}
+
 UPawnMovementComponent* AVehiclePawn::GetMovementComponent() const
 {
 	return VehicleMovementComponent;
+}
+
+void AVehiclePawn::UpdateAimDirection(const FVector& NewAimDirection, float DeltaTime)
+{
+	FVector Direction = NewAimDirection.GetSafeNormal();
+	if (!Direction.IsNearlyZero())
+	{
+		AimDirection = Direction;
+	}
+
+	if (HasAuthority())
+	{
+		return;
+	}
+
+	// send on a fixed interval rather than on every change, so moving the mouse doesn't flood the connection
+	AimSendTimer += DeltaTime;
+	if (AimSendTimer >= AimSendInterval)
+	{
+		AimSendTimer = 0.0f;
+		ServerSetAimDirection(AimDirection);
+	}
+}
+
+void AVehiclePawn::ServerSetAimDirection_Implementation(FVector_NetQuantizeNormal NewAimDirection)
+{
+	AimDirection = NewAimDirection.GetSafeNormal();
+}
+
+void AVehiclePawn::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	// the owner already knows where it is aiming
+	DOREPLIFETIME_CONDITION(AVehiclePawn, AimDirection, COND_SkipOwner);
 }
\ No newline at end of file
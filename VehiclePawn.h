@@ -11,6 +11,7 @@
 class UInputComponent;
 class UVehicleMovementComponent;
 class ATrafficPath;
+class UVehiclePerceptionSubsystem;
 
 UCLASS()
 class RL_POSTPERSON_API AVehiclePawn : public APawn
@@ -37,7 +38,13 @@ public:
 	/** Keep track if vehicle is blocked by an obstacle */
 	bool bIsBlocked = false;
 	/** Keep track of the distance to the obstacle */
-	float ObstacleDistance;
+	float ObstacleDistance = 0.0f;
+	/** Velocity of the obstacle at the last perception update, used to extrapolate ObstacleDistance */
+	FVector ObstacleVelocity = FVector::ZeroVector;
+	/** Keep track if the last perception update found an obstacle, possibly still beyond DistanceThreshold */
+	bool bHasObstacle = false;
+	/** Keep track if the cached obstacle blocks the vehicle once it is within DistanceThreshold */
+	bool bObstacleBlocks = false;
 	/** Keep track if vehicle has to brake */
 	bool bHasToBrake = false;
 	/** Keep track if obstacle is a vehicle */
@@ -70,9 +77,17 @@ public:
 protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
+	// Called when the game ends or when destroyed
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 
 	APlayerController *PlayerController;
 
+	/** Keep track if the last perception update started a move along the path */
+	bool bIsFollowingPath = false;
+	/** Scheduler running the AI perception of this vehicle, null if the vehicle updates its own perception every frame */
+	UPROPERTY()
+	UVehiclePerceptionSubsystem* PerceptionSubsystem;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Mesh")
 	UStaticMeshComponent* VehicleMesh;
 
@@ -108,6 +123,8 @@ protected:
 	FVector GroundNormal;
 	/** keep track if the vehicle is grounded */
 	bool bIsGrounded = false;
+	/** Suspension compression of each wheel, 0 fully compressed, 1 not touching the ground */
+	float SuspensionCompression[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
 	/** The force to apply to the vehicle when jumping */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Movement")
 	float JumpForce = 300;
@@ -120,6 +137,24 @@ protected:
 	/** The force to apply to the vehicle suspension */
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Movement")
 	float SuspensionForce = 1000000;
+	/** Direction the player is steering towards, set by the owning client and replicated so the server never deprojects the mouse */
+	UPROPERTY(Replicated)
+	FVector_NetQuantizeNormal AimDirection = FVector::ForwardVector;
+	/** How often the owning client sends its aim direction to the server, even if it has not changed */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category="Movement")
+	float AimSendInterval = 0.1f;
+	/** Time since the aim direction was last sent to the server */
+	float AimSendTimer = 0.0f;
+
+	/**
+	 * Set the aim direction locally and send it to the server every AimSendInterval if this is a client
+	 * @param NewAimDirection Direction the player is aiming at
+	 * @param DeltaTime Time since the last call
+	*/
+	void UpdateAimDirection(const FVector& NewAimDirection, float DeltaTime);
+	/** Send the aim direction from the owning client to the server, a lost send is corrected by the next one */
+	UFUNCTION(Server, Unreliable)
+	void ServerSetAimDirection(FVector_NetQuantizeNormal NewAimDirection);
 
 public:	
 	// Called every frame
@@ -127,18 +162,29 @@ public:
 
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
 	/** Input to move the vehicle */
 	void MoveVehicle(const FInputActionValue& Value);
 	/** Input to activate the handbrake */
 	void HandbrakeVehicle(const FInputActionValue& Value);
 	/** Input to jump the vehicle */
 	void JumpVehicle(const FInputActionValue& Value);
+	/**
+	 * Sweep for obstacles, check the player proximity and move towards the next point on the path
+	 * @param UpdateInterval Expected time until the next update, the obstacle sweep and path look-ahead are pushed further by the distance travelled in it
+	*/
+	void UpdatePerception(float UpdateInterval = 0.0f);
+	/** Extrapolate the cached obstacle distance from the closing speed between perception updates */
+	void ExtrapolatePerception(float DeltaTime);
 	/** Get the current movement component of this pawn */
 	virtual UPawnMovementComponent* GetMovementComponent() const override;
 	/** Get the current Ground Normal of the vehicle */
 	FVector GetGroundNormal() const { return GroundNormal; }
 	/** Get if the vehicle is grounded or not */
 	bool IsGrounded() const { return bIsGrounded; }
+	/** Get the suspension compression of a wheel (FL, FR, RL, RR) */
+	float GetSuspensionCompression(int32 WheelIndex) const { return SuspensionCompression[WheelIndex]; }
 	/** Get the vehicle mesh component */
 	UStaticMeshComponent * GetStaticMeshComponent() const { return VehicleMesh; }
 	/** Get the vehicle acceleration root component */
@@ -0,0 +1,107 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VehiclePerceptionSubsystem.h"
+#include "VehiclePawn.h"
+#include "Engine/World.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+
+namespace VehiclePerception
+{
+	int32 MaxUpdatesPerFrame = 32;
+	FAutoConsoleVariableRef CVarMaxUpdatesPerFrame(
+		TEXT("vehicle.Perception.MaxUpdatesPerFrame"),
+		MaxUpdatesPerFrame,
+		TEXT("Maximum AI vehicle perception updates per frame, each update is one obstacle sweep, a player proximity check and a path look-ahead. 0 for no limit."));
+
+	float MaxMicrosecondsPerFrame = 0.0f;
+	FAutoConsoleVariableRef CVarMaxMicrosecondsPerFrame(
+		TEXT("vehicle.Perception.MaxMicrosecondsPerFrame"),
+		MaxMicrosecondsPerFrame,
+		TEXT("Time budget in microseconds for AI vehicle perception updates per frame. 0 for no limit."));
+
+	float PrioritySpeedScale = 1000.0f;
+	FAutoConsoleVariableRef CVarPrioritySpeedScale(
+		TEXT("vehicle.Perception.PrioritySpeedScale"),
+		PrioritySpeedScale,
+		TEXT("Speed at which a vehicle gets twice the update priority of a stopped vehicle."));
+}
+
+void UVehiclePerceptionSubsystem::RegisterVehicle(AVehiclePawn* Vehicle)
+{
+	FScheduledVehicle& Scheduled = Vehicles.AddDefaulted_GetRef();
+	Scheduled.Vehicle = Vehicle;
+}
+
+void UVehiclePerceptionSubsystem::RequestUpdate(AVehiclePawn* Vehicle)
+{
+	if (FScheduledVehicle* Scheduled = Vehicles.FindByPredicate([Vehicle](const FScheduledVehicle& Scheduled) { return Scheduled.Vehicle == Vehicle; }))
+	{
+		Scheduled->bUpdateRequested = true;
+	}
+}
+
+void UVehiclePerceptionSubsystem::UnregisterVehicle(AVehiclePawn* Vehicle)
+{
+	Vehicles.RemoveAllSwap([Vehicle](const FScheduledVehicle& Scheduled) { return Scheduled.Vehicle == Vehicle; });
+}
+
+void UVehiclePerceptionSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// drop vehicles destroyed without unregistering
+	Vehicles.RemoveAllSwap([](const FScheduledVehicle& Scheduled) { return !Scheduled.Vehicle.IsValid(); });
+	if (Vehicles.Num() == 0)
+	{
+		return;
+	}
+
+	const double Time = GetWorld()->GetTimeSeconds();
+
+	// priority grows with the time since the last update so every vehicle is eventually updated, faster vehicles grow quicker
+	UpdateOrder.Reset();
+	for (int32 i = 0; i < Vehicles.Num(); i++)
+	{
+		FScheduledVehicle& Scheduled = Vehicles[i];
+		if (Scheduled.bNeverUpdated || Scheduled.bUpdateRequested)
+		{
+			Scheduled.Priority = MAX_flt;
+		}
+		else
+		{
+			float Speed = Scheduled.Vehicle->GetVelocity().Size();
+			Scheduled.Priority = (float)(Time - Scheduled.LastUpdateTime) * (1.0f + Speed / FMath::Max(VehiclePerception::PrioritySpeedScale, 1.0f));
+		}
+		UpdateOrder.Add(i);
+	}
+
+	UpdateOrder.Sort([this](int32 A, int32 B) { return Vehicles[A].Priority > Vehicles[B].Priority; });
+	if (VehiclePerception::MaxUpdatesPerFrame > 0 && UpdateOrder.Num() > VehiclePerception::MaxUpdatesPerFrame)
+	{
+		UpdateOrder.SetNum(VehiclePerception::MaxUpdatesPerFrame, EAllowShrinking::No);
+	}
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	for (int32 Index : UpdateOrder)
+	{
+		FScheduledVehicle& Scheduled = Vehicles[Index];
+		Scheduled.Vehicle->UpdatePerception(Scheduled.bNeverUpdated ? 0.0f : (float)(Time - Scheduled.LastUpdateTime));
+		Scheduled.LastUpdateTime = Time;
+		Scheduled.bNeverUpdated = false;
+		Scheduled.bUpdateRequested = false;
+
+		// always do at least one update so the scheduler can't stall
+		if (VehiclePerception::MaxMicrosecondsPerFrame > 0.0f
+			&& FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - StartCycles) * 1000.0 >= VehiclePerception::MaxMicrosecondsPerFrame)
+		{
+			break;
+		}
+	}
+}
+
+TStatId UVehiclePerceptionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UVehiclePerceptionSubsystem, STATGROUP_Tickables);
+}
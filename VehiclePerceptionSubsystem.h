@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "VehiclePerceptionSubsystem.generated.h"
+
+class AVehiclePawn;
+
+/**
+ * Owns the perception work of every AI vehicle in the world (obstacle sweep, player proximity and path look-ahead).
+ * Each frame the vehicles most in need of an update are updated, prioritised by speed and time since their
+ * last update, until the per-frame update or time budget runs out. Vehicles that are not updated extrapolate
+ * their cached obstacle distance, so the query cost stays flat no matter how many vehicles are active.
+ *
+ * Budget is controlled with vehicle.Perception.MaxUpdatesPerFrame and vehicle.Perception.MaxMicrosecondsPerFrame.
+ */
+UCLASS()
+class RL_POSTPERSON_API UVehiclePerceptionSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	/** Start scheduling the perception of a vehicle, it is updated on the next frame */
+	void RegisterVehicle(AVehiclePawn* Vehicle);
+	/** Update a vehicle ahead of the others on the next frame, for when its cached perception is no longer usable */
+	void RequestUpdate(AVehiclePawn* Vehicle);
+	/** Stop scheduling the perception of a vehicle */
+	void UnregisterVehicle(AVehiclePawn* Vehicle);
+
+	virtual void Tick(float DeltaTime) override;
+	virtual TStatId GetStatId() const override;
+
+protected:
+	/** Perception state the scheduler keeps for each vehicle */
+	struct FScheduledVehicle
+	{
+		TWeakObjectPtr<AVehiclePawn> Vehicle;
+		/** World time of the last perception update */
+		double LastUpdateTime = 0.0;
+		/** Vehicle has not been updated since it was registered */
+		bool bNeverUpdated = true;
+		/** Vehicle asked to be updated as soon as possible */
+		bool bUpdateRequested = false;
+		/** Priority computed this frame */
+		float Priority = 0.0f;
+	};
+
+	TArray<FScheduledVehicle> Vehicles;
+	/** Indices into Vehicles sorted by priority, kept around to avoid reallocating each frame */
+	TArray<int32> UpdateOrder;
+};
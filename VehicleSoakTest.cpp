@@ -0,0 +1,241 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VehicleSoakTest.h"
+#include "VehiclePawn.h"
+#include "TrafficPath.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "GameFramework/Controller.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "CoreGlobals.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/CommandLine.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVehicleSoak, Log, All);
+
+namespace VehicleSoak
+{
+	/** Distance between spawned vehicles */
+	constexpr float Spacing = 800.0f;
+	constexpr float SpawnHeight = 200.0f;
+	/** Sideways distance between vehicles spawned on separate passes along the path */
+	constexpr float LaneWidth = 400.0f;
+
+	FAutoConsoleCommandWithWorldAndArgs SoakCommand(
+		TEXT("Vehicle.Soak"),
+		TEXT("Spawn AI vehicles in steps of 100 and log CPU and memory per step. Arguments: VehicleClassPath [MaxVehicles=1000] [SecondsPerStep=10] [TrafficPathName]. Use 'Vehicle.Soak Stop' to stop."),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateLambda([](const TArray<FString>& Args, UWorld* World)
+		{
+			if (Args.Num() == 0)
+			{
+				UE_LOG(LogVehicleSoak, Warning, TEXT("Vehicle.Soak needs a vehicle class path"));
+				return;
+			}
+			if (Args[0] == TEXT("Stop"))
+			{
+				FVehicleSoakTest::Stop();
+				return;
+			}
+
+			UClass* VehicleClass = LoadClass<AVehiclePawn>(nullptr, *Args[0]);
+			if (!VehicleClass)
+			{
+				UE_LOG(LogVehicleSoak, Warning, TEXT("Could not load vehicle class %s"), *Args[0]);
+				return;
+			}
+
+			int32 MaxVehicles = Args.Num() > 1 ? FCString::Atoi(*Args[1]) : 1000;
+			float SecondsPerStep = Args.Num() > 2 ? FCString::Atof(*Args[2]) : 10.0f;
+
+			// use the named traffic path, or the first one in the world
+			ATrafficPath* Path = nullptr;
+			for (TActorIterator<ATrafficPath> It(World); It; ++It)
+			{
+				if (Args.Num() <= 3 || It->GetName() == Args[3])
+				{
+					Path = *It;
+					break;
+				}
+			}
+			if (!Path)
+			{
+				UE_LOG(LogVehicleSoak, Warning, TEXT("No traffic path found, soak vehicles will not follow a path"));
+			}
+
+			FVehicleSoakTest::Start(World, VehicleClass, FMath::Max(MaxVehicles, FVehicleSoakTest::VehiclesPerStep), FMath::Max(SecondsPerStep, 1.0f), Path);
+		}));
+
+	double ToMegabytes(uint64 Bytes)
+	{
+		return Bytes / (1024.0 * 1024.0);
+	}
+}
+
+TUniquePtr<FVehicleSoakTest> FVehicleSoakTest::Instance;
+
+void FVehicleSoakTest::Start(UWorld* InWorld, TSubclassOf<AVehiclePawn> InVehicleClass, int32 InMaxVehicles, float InSecondsPerStep, ATrafficPath* InPath)
+{
+	Stop();
+	Instance.Reset(new FVehicleSoakTest(InWorld, InVehicleClass, InMaxVehicles, InSecondsPerStep, InPath));
+}
+
+void FVehicleSoakTest::Stop()
+{
+	Instance.Reset();
+}
+
+FVehicleSoakTest::FVehicleSoakTest(UWorld* InWorld, TSubclassOf<AVehiclePawn> InVehicleClass, int32 InMaxVehicles, float InSecondsPerStep, ATrafficPath* InPath)
+	: World(InWorld)
+	, VehicleClass(InVehicleClass)
+	, Path(InPath)
+	, MaxVehicles(InMaxVehicles)
+	, SecondsPerStep(InSecondsPerStep)
+{
+	UE_LOG(LogVehicleSoak, Display, TEXT("Starting vehicle soak test with %s, up to %d vehicles, %.1fs per step"), *VehicleClass->GetName(), MaxVehicles, SecondsPerStep);
+
+	// the first step measures the world without any soak vehicles as a baseline
+	TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateRaw(this, &FVehicleSoakTest::Tick));
+}
+
+FVehicleSoakTest::~FVehicleSoakTest()
+{
+	FTSTicker::GetCoreTicker().RemoveTicker(TickerHandle);
+
+	for (TWeakObjectPtr<AVehiclePawn>& Vehicle : Vehicles)
+	{
+		if (Vehicle.IsValid())
+		{
+			if (AController* Controller = Vehicle->GetController())
+			{
+				Controller->Destroy();
+			}
+			Vehicle->Destroy();
+		}
+	}
+}
+
+bool FVehicleSoakTest::Tick(float DeltaTime)
+{
+	if (!World.IsValid())
+	{
+		UE_LOG(LogVehicleSoak, Warning, TEXT("Soak test world was destroyed, stopping"));
+		Finish();
+		return false;
+	}
+
+	StepTimer += DeltaTime;
+	StepFrames++;
+	// the server frame is capped by its tick rate, the game thread time is the work actually done
+	StepGameThreadTime += FPlatformTime::ToMilliseconds(GGameThreadTime);
+	StepCPUUsage += FPlatformTime::GetCPUTime().CPUTimePct;
+
+	if (StepTimer < SecondsPerStep)
+	{
+		return true;
+	}
+
+	ReportStep();
+
+	if (SpawnAttempts >= MaxVehicles)
+	{
+		UE_LOG(LogVehicleSoak, Display, TEXT("Vehicle soak test finished with %d of %d vehicles spawned"), Vehicles.Num(), SpawnAttempts);
+		Finish();
+		return false;
+	}
+
+	if (SpawnStep() == 0)
+	{
+		UE_LOG(LogVehicleSoak, Error, TEXT("Could not spawn any vehicle of this step, aborting the soak test"));
+		Finish();
+		return false;
+	}
+
+	StepTimer = 0.0f;
+	StepFrames = 0;
+	StepGameThreadTime = 0.0;
+	StepCPUUsage = 0.0;
+	return true;
+}
+
+void FVehicleSoakTest::Finish()
+{
+	if (FParse::Param(FCommandLine::Get(), TEXT("SoakExit")))
+	{
+		FPlatformMisc::RequestExit(false);
+	}
+	Instance.Reset();
+}
+
+int32 FVehicleSoakTest::SpawnStep()
+{
+	const int32 Last = FMath::Min(SpawnAttempts + VehiclesPerStep, MaxVehicles);
+	int32 Spawned = 0;
+
+	for (; SpawnAttempts < Last; SpawnAttempts++)
+	{
+		FTransform SpawnTransform = GetSpawnTransform(SpawnAttempts);
+		AVehiclePawn* Vehicle = World->SpawnActorDeferred<AVehiclePawn>(VehicleClass, SpawnTransform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+		if (!Vehicle)
+		{
+			continue;
+		}
+
+		Vehicle->bIsAI = true;
+		Vehicle->CarPath = Path.Get();
+		Vehicle->FinishSpawning(SpawnTransform);
+		Vehicle->SpawnDefaultController();
+		Vehicles.Add(Vehicle);
+		Spawned++;
+	}
+	return Spawned;
+}
+
+FTransform FVehicleSoakTest::GetSpawnTransform(int32 Index) const
+{
+	if (Path.IsValid() && Path->PathSpline->GetSplineLength() > VehicleSoak::Spacing)
+	{
+		// space vehicles along the path, each time the path is full start a new lane next to it
+		const float Length = Path->PathSpline->GetSplineLength();
+		const int32 PerLane = FMath::FloorToInt(Length / VehicleSoak::Spacing);
+		const float Distance = (Index % PerLane) * VehicleSoak::Spacing;
+		const int32 Lane = Index / PerLane;
+
+		FVector Location = Path->PathSpline->GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+		FRotator Rotation = Path->PathSpline->GetRotationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+		FVector Right = Path->PathSpline->GetRightVectorAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::World);
+		Location += Right * Lane * VehicleSoak::LaneWidth + FVector::UpVector * VehicleSoak::SpawnHeight;
+		return FTransform(Rotation, Location);
+	}
+
+	const int32 Columns = FMath::CeilToInt(FMath::Sqrt((float)MaxVehicles));
+	return FTransform(FVector((Index % Columns) * VehicleSoak::Spacing, (Index / Columns) * VehicleSoak::Spacing, VehicleSoak::SpawnHeight));
+}
+
+void FVehicleSoakTest::ReportStep()
+{
+	const double GameThreadTime = StepFrames > 0 ? StepGameThreadTime / StepFrames : 0.0;
+	const double CPUUsage = StepFrames > 0 ? StepCPUUsage / StepFrames : 0.0;
+	const uint64 Memory = FPlatformMemory::GetStats().UsedPhysical;
+
+	if (!bHasBaseline)
+	{
+		bHasBaseline = true;
+		BaselineGameThreadTime = GameThreadTime;
+		BaselineCPUUsage = CPUUsage;
+		BaselineMemory = Memory;
+		UE_LOG(LogVehicleSoak, Display, TEXT("Baseline: game thread %.2f ms, CPU %.1f%%, memory %.1f MB"), GameThreadTime, CPUUsage, VehicleSoak::ToMegabytes(Memory));
+		return;
+	}
+
+	const double Hundreds = FMath::Max(Vehicles.Num(), 1) / (double)VehiclesPerStep;
+	UE_LOG(LogVehicleSoak, Display, TEXT("%d vehicles: game thread %.2f ms (%.2f ms per 100), CPU %.1f%% (%.1f%% per 100), memory %.1f MB (%.1f MB per 100)"),
+		Vehicles.Num(),
+		GameThreadTime,
+		(GameThreadTime - BaselineGameThreadTime) / Hundreds,
+		CPUUsage,
+		(CPUUsage - BaselineCPUUsage) / Hundreds,
+		VehicleSoak::ToMegabytes(Memory),
+		(VehicleSoak::ToMegabytes(Memory) - VehicleSoak::ToMegabytes(BaselineMemory)) / Hundreds);
+}
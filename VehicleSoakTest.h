@@ -0,0 +1,75 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Templates/SubclassOf.h"
+
+class AVehiclePawn;
+class ATrafficPath;
+class UWorld;
+
+/**
+ * Soak test for the vehicle stack, meant to be run headless with -server -nullrhi.
+ * Spawns AI vehicles in steps of a hundred along a traffic path and logs the game thread time, CPU usage and memory of each step.
+ *
+ * Usage: Vehicle.Soak <VehicleClassPath> [MaxVehicles] [SecondsPerStep] [TrafficPathName]
+ * Without a path name the first traffic path in the world is used.
+ * Pass -SoakExit on the command line to quit once the soak test finishes.
+ */
+class RL_POSTPERSON_API FVehicleSoakTest
+{
+public:
+	/**
+	 * Start a soak test, replacing any soak test already running
+	 * @param InWorld World to spawn the vehicles in
+	 * @param InVehicleClass Vehicle to spawn, usually a blueprint with meshes and collision set up
+	 * @param InMaxVehicles Amount of vehicles to stop at
+	 * @param InSecondsPerStep How long to measure each step of a hundred vehicles
+	 * @param InPath Path the vehicles follow, null to leave them parked
+	*/
+	static void Start(UWorld* InWorld, TSubclassOf<AVehiclePawn> InVehicleClass, int32 InMaxVehicles, float InSecondsPerStep, ATrafficPath* InPath);
+	/** Stop the current soak test and destroy its vehicles */
+	static void Stop();
+
+	/** Vehicles spawned on each step */
+	static constexpr int32 VehiclesPerStep = 100;
+
+private:
+	FVehicleSoakTest(UWorld* InWorld, TSubclassOf<AVehiclePawn> InVehicleClass, int32 InMaxVehicles, float InSecondsPerStep, ATrafficPath* InPath);
+	~FVehicleSoakTest();
+
+	bool Tick(float DeltaTime);
+	/** Spawn the next hundred vehicles, returns the amount of vehicles spawned */
+	int32 SpawnStep();
+	/** Get where to spawn a vehicle, along the path if there is one */
+	FTransform GetSpawnTransform(int32 Index) const;
+	/** End the soak test, quitting if -SoakExit was passed */
+	void Finish();
+	/** Log the measurements of the step that just finished */
+	void ReportStep();
+
+	static TUniquePtr<FVehicleSoakTest> Instance;
+
+	TWeakObjectPtr<UWorld> World;
+	TSubclassOf<AVehiclePawn> VehicleClass;
+	TWeakObjectPtr<ATrafficPath> Path;
+	int32 MaxVehicles;
+	/** Spawns tried so far, failed spawns count too so the test always finishes */
+	int32 SpawnAttempts = 0;
+	float SecondsPerStep;
+	TArray<TWeakObjectPtr<AVehiclePawn>> Vehicles;
+	FTSTicker::FDelegateHandle TickerHandle;
+
+	/** Measurements of the current step */
+	float StepTimer = 0.0f;
+	int32 StepFrames = 0;
+	double StepGameThreadTime = 0.0;
+	double StepCPUUsage = 0.0;
+	/** Measurements taken before any vehicle was spawned */
+	double BaselineGameThreadTime = 0.0;
+	double BaselineCPUUsage = 0.0;
+	uint64 BaselineMemory = 0;
+	bool bHasBaseline = false;
+};
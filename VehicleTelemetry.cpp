@@ -0,0 +1,546 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VehicleTelemetry.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/FileManager.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/Compression.h"
+#include "Misc/Paths.h"
+#include "Misc/DateTime.h"
+#include "Misc/CoreDelegates.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVehicleTelemetry, Log, All);
+
+namespace VehicleTelemetry
+{
+	/** How often the writer thread drains the ring buffers */
+	constexpr uint32 DrainIntervalMs = 50;
+
+	float SampleRate = 30.0f;
+	FAutoConsoleVariableRef CVarSampleRate(
+		TEXT("vehicle.Telemetry.SampleRate"),
+		SampleRate,
+		TEXT("Samples per second recorded for each vehicle, 0 records every frame."));
+
+	FString Filter;
+	TArray<FString> FilterNames;
+	uint32 FilterSerial = 0;
+	FAutoConsoleVariableRef CVarFilter(
+		TEXT("vehicle.Telemetry.Filter"),
+		Filter,
+		TEXT("Comma separated list of vehicle names to record, empty records every vehicle."),
+		FConsoleVariableDelegate::CreateLambda([](IConsoleVariable*)
+		{
+			FilterNames.Reset();
+			Filter.ParseIntoArray(FilterNames, TEXT(","), true);
+			for (FString& Name : FilterNames)
+			{
+				Name.TrimStartAndEndInline();
+			}
+			FilterSerial++;
+		}));
+
+	FAutoConsoleCommand StartCommand(
+		TEXT("Vehicle.Telemetry.Start"),
+		TEXT("Start recording vehicle telemetry. Optional argument: file name."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([](const TArray<FString>& Args)
+		{
+			FString FileName = Args.Num() > 0 ? Args[0] : FString::Printf(TEXT("Vehicles_%s.vtlm"), *FDateTime::Now().ToString());
+			FVehicleTelemetry::Get().StartRecording(FileName);
+		}));
+
+	FAutoConsoleCommand StopCommand(
+		TEXT("Vehicle.Telemetry.Stop"),
+		TEXT("Stop recording vehicle telemetry."),
+		FConsoleCommandDelegate::CreateLambda([]()
+		{
+			FVehicleTelemetry::Get().StopRecording();
+		}));
+
+	/** How a column is stored in the file */
+	enum class EColumnStorage : uint8
+	{
+		Raw = 0,
+		Zlib = 1,
+	};
+
+	/** Compress a column and write it to the archive */
+	void WriteColumn(FArchive& Ar, const void* Data, int32 Size)
+	{
+		int32 CompressedSize = FCompression::CompressMemoryBound(NAME_Zlib, Size);
+		TArray<uint8> Compressed;
+		Compressed.SetNumUninitialized(CompressedSize);
+
+		uint8 Storage = (uint8)EColumnStorage::Zlib;
+		if (!FCompression::CompressMemory(NAME_Zlib, Compressed.GetData(), CompressedSize, Data, Size))
+		{
+			Storage = (uint8)EColumnStorage::Raw;
+			CompressedSize = Size;
+			Compressed.SetNumUninitialized(Size);
+			FMemory::Memcpy(Compressed.GetData(), Data, Size);
+		}
+
+		Ar << Storage;
+		Ar << Size;
+		Ar << CompressedSize;
+		Ar.Serialize(Compressed.GetData(), CompressedSize);
+	}
+
+	/** Read a column written by WriteColumn, the column must hold exactly Size bytes */
+	bool ReadColumn(FArchive& Ar, void* Data, int32 Size)
+	{
+		uint8 Storage = 0;
+		int32 UncompressedSize = 0;
+		int32 CompressedSize = 0;
+		Ar << Storage;
+		Ar << UncompressedSize;
+		Ar << CompressedSize;
+
+		if (Ar.IsError() || UncompressedSize != Size || CompressedSize < 0 || CompressedSize > Ar.TotalSize() - Ar.Tell())
+		{
+			return false;
+		}
+
+		TArray<uint8> Compressed;
+		Compressed.SetNumUninitialized(CompressedSize);
+		Ar.Serialize(Compressed.GetData(), CompressedSize);
+		if (Ar.IsError())
+		{
+			return false;
+		}
+
+		switch ((EColumnStorage)Storage)
+		{
+		case EColumnStorage::Raw:
+			if (CompressedSize != Size)
+			{
+				return false;
+			}
+			FMemory::Memcpy(Data, Compressed.GetData(), Size);
+			return true;
+		case EColumnStorage::Zlib:
+			return FCompression::UncompressMemory(NAME_Zlib, Data, Size, Compressed.GetData(), CompressedSize);
+		default:
+			return false;
+		}
+	}
+}
+
+FVehicleTelemetry& FVehicleTelemetry::Get()
+{
+	static FVehicleTelemetry Instance;
+	return Instance;
+}
+
+FVehicleTelemetry::FVehicleTelemetry()
+{
+	// stop while the engine is still alive, the singleton itself is only destroyed during static destruction
+	FCoreDelegates::OnPreExit.AddRaw(this, &FVehicleTelemetry::StopRecording);
+}
+
+FVehicleTelemetry::~FVehicleTelemetry()
+{
+	// OnPreExit did not run, the writer thread may still be using the rings
+	if (IsRecording())
+	{
+		return;
+	}
+
+	FThreadRing* Ring = RingHead.exchange(nullptr);
+	while (Ring)
+	{
+		FThreadRing* Next = Ring->Next;
+		delete Ring;
+		Ring = Next;
+	}
+}
+
+bool FVehicleTelemetry::StartRecording(const FString& FileName)
+{
+	check(IsInGameThread());
+
+	if (IsRecording())
+	{
+		return false;
+	}
+
+	FString FullPath = FPaths::IsRelative(FileName) ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Telemetry"), FileName) : FileName;
+	FileWriter = IFileManager::Get().CreateFileWriter(*FullPath);
+	if (!FileWriter)
+	{
+		UE_LOG(LogVehicleTelemetry, Warning, TEXT("Could not open telemetry file %s"), *FullPath);
+		return false;
+	}
+
+	uint32 Magic = FileMagic;
+	uint32 Version = FileVersion;
+	*FileWriter << Magic;
+	*FileWriter << Version;
+
+	// discard samples left over from a previous recording, the writer thread is not running so we are the only consumer
+	for (FThreadRing* Ring = RingHead.load(std::memory_order_acquire); Ring; Ring = Ring->Next)
+	{
+		FVehicleTelemetrySample Discard;
+		while (Ring->Queue.Dequeue(Discard)) {}
+	}
+
+	DroppedAtStart = GetTotalDroppedSamples();
+	WakeEvent = FPlatformProcess::GetSynchEventFromPool(false);
+	bStopRequested = false;
+
+	{
+		// queue the vehicles registered so far, RegisterVehicle queues the rest once we are recording
+		FScopeLock Lock(&NamesLock);
+		PendingNames.Reset();
+		for (const TPair<uint32, FString>& Name : VehicleNames)
+		{
+			PendingNames.Add(Name);
+		}
+		bIsRecording = true;
+	}
+
+	WriterThread = FRunnableThread::Create(this, TEXT("VehicleTelemetryWriter"), 0, TPri_BelowNormal);
+
+	if (!WriterThread)
+	{
+		UE_LOG(LogVehicleTelemetry, Warning, TEXT("Could not create the telemetry writer thread"));
+		bIsRecording = false;
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+		WakeEvent = nullptr;
+		FileWriter->Close();
+		delete FileWriter;
+		FileWriter = nullptr;
+		return false;
+	}
+
+	UE_LOG(LogVehicleTelemetry, Log, TEXT("Recording vehicle telemetry to %s"), *FullPath);
+	return true;
+}
+
+void FVehicleTelemetry::StopRecording()
+{
+	if (!IsRecording())
+	{
+		return;
+	}
+
+	bIsRecording = false;
+	Stop();
+	WriterThread->WaitForCompletion();
+	delete WriterThread;
+	WriterThread = nullptr;
+
+	FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	WakeEvent = nullptr;
+
+	FileWriter->Close();
+	delete FileWriter;
+	FileWriter = nullptr;
+
+	UE_LOG(LogVehicleTelemetry, Log, TEXT("Stopped recording vehicle telemetry, %llu samples dropped"), GetDroppedSamples());
+}
+
+uint32 FVehicleTelemetry::RegisterVehicle(const FString& VehicleName)
+{
+	FScopeLock Lock(&NamesLock);
+	uint32 VehicleId = NextVehicleId++;
+	VehicleNames.Add(VehicleId, VehicleName);
+	// StartRecording queues every registered vehicle, so only new vehicles need queueing while recording
+	if (IsRecording())
+	{
+		PendingNames.Emplace(VehicleId, VehicleName);
+	}
+	return VehicleId;
+}
+
+void FVehicleTelemetry::UnregisterVehicle(uint32 VehicleId)
+{
+	FScopeLock Lock(&NamesLock);
+	VehicleNames.Remove(VehicleId);
+}
+
+bool FVehicleTelemetry::Push(const FVehicleTelemetrySample& Sample)
+{
+	FThreadRing* Ring = GetThreadRing();
+	if (!Ring->Queue.Enqueue(Sample))
+	{
+		// only this thread writes the counter, no need for a read-modify-write
+		Ring->Dropped.store(Ring->Dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+FVehicleTelemetry::FThreadRing* FVehicleTelemetry::GetThreadRing()
+{
+	static thread_local FThreadRing* ThreadRing = nullptr;
+	if (!ThreadRing)
+	{
+		// first push from this thread, link a new ring at the head of the list
+		ThreadRing = new FThreadRing();
+		FThreadRing* Head = RingHead.load(std::memory_order_relaxed);
+		do
+		{
+			ThreadRing->Next = Head;
+		} while (!RingHead.compare_exchange_weak(Head, ThreadRing, std::memory_order_release, std::memory_order_relaxed));
+	}
+	return ThreadRing;
+}
+
+bool FVehicleTelemetry::PassesFilter(const FString& VehicleName)
+{
+	return VehicleTelemetry::FilterNames.Num() == 0 || VehicleTelemetry::FilterNames.Contains(VehicleName);
+}
+
+uint32 FVehicleTelemetry::GetFilterSerial()
+{
+	return VehicleTelemetry::FilterSerial;
+}
+
+float FVehicleTelemetry::GetSampleInterval()
+{
+	return VehicleTelemetry::SampleRate > 0.0f ? 1.0f / VehicleTelemetry::SampleRate : 0.0f;
+}
+
+uint64 FVehicleTelemetry::GetDroppedSamples() const
+{
+	return GetTotalDroppedSamples() - DroppedAtStart;
+}
+
+uint64 FVehicleTelemetry::GetTotalDroppedSamples() const
+{
+	uint64 Dropped = 0;
+	for (FThreadRing* Ring = RingHead.load(std::memory_order_acquire); Ring; Ring = Ring->Next)
+	{
+		Dropped += Ring->Dropped.load(std::memory_order_relaxed);
+	}
+	return Dropped;
+}
+
+uint32 FVehicleTelemetry::Run()
+{
+	while (!bStopRequested)
+	{
+		WakeEvent->Wait(VehicleTelemetry::DrainIntervalMs);
+		DrainRings();
+	}
+
+	// final drain so nothing pushed before StopRecording is lost
+	DrainRings();
+	FlushToFile();
+	return 0;
+}
+
+void FVehicleTelemetry::Stop()
+{
+	bStopRequested = true;
+	if (WakeEvent)
+	{
+		WakeEvent->Trigger();
+	}
+}
+
+int32 FVehicleTelemetry::DrainRings()
+{
+	int32 Drained = 0;
+	FVehicleTelemetrySample Sample;
+
+	for (FThreadRing* Ring = RingHead.load(std::memory_order_acquire); Ring; Ring = Ring->Next)
+	{
+		while (Ring->Queue.Dequeue(Sample))
+		{
+			TimeColumn.Add(Sample.Time);
+			VehicleIdColumn.Add(Sample.VehicleId);
+			FloatColumns[0].Add(Sample.Speed);
+			FloatColumns[1].Add(Sample.Throttle);
+			FloatColumns[2].Add(Sample.Angle);
+			FloatColumns[3].Add(Sample.ObstacleDistance);
+			for (int32 i = 0; i < 4; i++)
+			{
+				FloatColumns[4 + i].Add(Sample.SuspensionCompression[i]);
+			}
+			FlagsColumn.Add(Sample.Flags);
+			Drained++;
+
+			if (TimeColumn.Num() >= SamplesPerChunk)
+			{
+				FlushToFile();
+			}
+		}
+	}
+	return Drained;
+}
+
+void FVehicleTelemetry::FlushToFile()
+{
+	WriteNames();
+	WriteSamples();
+}
+
+void FVehicleTelemetry::WriteNames()
+{
+	TArray<TPair<uint32, FString>> Names;
+	{
+		FScopeLock Lock(&NamesLock);
+		Names = MoveTemp(PendingNames);
+		PendingNames.Reset();
+	}
+
+	if (Names.Num() == 0)
+	{
+		return;
+	}
+
+	uint8 Chunk = (uint8)EChunk::Names;
+	int32 Count = Names.Num();
+	*FileWriter << Chunk;
+	*FileWriter << Count;
+	for (TPair<uint32, FString>& Name : Names)
+	{
+		*FileWriter << Name.Key;
+		*FileWriter << Name.Value;
+	}
+}
+
+void FVehicleTelemetry::WriteSamples()
+{
+	int32 NumSamples = TimeColumn.Num();
+	if (NumSamples == 0)
+	{
+		return;
+	}
+
+	uint8 Chunk = (uint8)EChunk::Samples;
+	uint64 Dropped = GetDroppedSamples();
+	*FileWriter << Chunk;
+	*FileWriter << NumSamples;
+	*FileWriter << Dropped;
+
+	// columns are written in EColumn order
+	VehicleTelemetry::WriteColumn(*FileWriter, TimeColumn.GetData(), NumSamples * sizeof(double));
+	VehicleTelemetry::WriteColumn(*FileWriter, VehicleIdColumn.GetData(), NumSamples * sizeof(uint32));
+	for (TArray<float>& Column : FloatColumns)
+	{
+		VehicleTelemetry::WriteColumn(*FileWriter, Column.GetData(), NumSamples * sizeof(float));
+		Column.Reset();
+	}
+	VehicleTelemetry::WriteColumn(*FileWriter, FlagsColumn.GetData(), NumSamples * sizeof(uint8));
+
+	TimeColumn.Reset();
+	VehicleIdColumn.Reset();
+	FlagsColumn.Reset();
+}
+
+bool FVehicleTelemetryReader::Load(const FString& FileName)
+{
+	Samples.Reset();
+	VehicleNames.Reset();
+	DroppedSamples = 0;
+
+	TUniquePtr<FArchive> Ar(IFileManager::Get().CreateFileReader(*FileName));
+	if (!Ar)
+	{
+		return false;
+	}
+
+	uint32 Magic = 0;
+	uint32 Version = 0;
+	*Ar << Magic;
+	*Ar << Version;
+	if (Magic != FVehicleTelemetry::FileMagic || Version != FVehicleTelemetry::FileVersion)
+	{
+		return false;
+	}
+
+	while (!Ar->AtEnd() && !Ar->IsError())
+	{
+		uint8 Chunk = 0;
+		*Ar << Chunk;
+
+		if (Chunk == (uint8)FVehicleTelemetry::EChunk::Names)
+		{
+			int32 Count = 0;
+			*Ar << Count;
+			for (int32 i = 0; i < Count && !Ar->IsError(); i++)
+			{
+				uint32 VehicleId = 0;
+				FString VehicleName;
+				*Ar << VehicleId;
+				*Ar << VehicleName;
+				VehicleNames.Add(VehicleId, VehicleName);
+			}
+		}
+		else if (Chunk == (uint8)FVehicleTelemetry::EChunk::Samples)
+		{
+			if (!ReadSamples(*Ar))
+			{
+				return false;
+			}
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return !Ar->IsError();
+}
+
+bool FVehicleTelemetryReader::ReadSamples(FArchive& Ar)
+{
+	int32 NumSamples = 0;
+	uint64 Dropped = 0;
+	Ar << NumSamples;
+	Ar << Dropped;
+	// the writer never stages more than a chunk, anything bigger is a corrupt file
+	if (Ar.IsError() || NumSamples <= 0 || NumSamples > FVehicleTelemetry::SamplesPerChunk)
+	{
+		return false;
+	}
+	// the dropped counter is cumulative, the last chunk holds the total
+	DroppedSamples = Dropped;
+
+	TArray<double> Time;
+	TArray<uint32> VehicleId;
+	TArray<float> FloatColumns[8];
+	TArray<uint8> Flags;
+	Time.SetNumUninitialized(NumSamples);
+	VehicleId.SetNumUninitialized(NumSamples);
+	Flags.SetNumUninitialized(NumSamples);
+
+	if (!VehicleTelemetry::ReadColumn(Ar, Time.GetData(), NumSamples * sizeof(double))
+		|| !VehicleTelemetry::ReadColumn(Ar, VehicleId.GetData(), NumSamples * sizeof(uint32)))
+	{
+		return false;
+	}
+	for (TArray<float>& Column : FloatColumns)
+	{
+		Column.SetNumUninitialized(NumSamples);
+		if (!VehicleTelemetry::ReadColumn(Ar, Column.GetData(), NumSamples * sizeof(float)))
+		{
+			return false;
+		}
+	}
+	if (!VehicleTelemetry::ReadColumn(Ar, Flags.GetData(), NumSamples * sizeof(uint8)))
+	{
+		return false;
+	}
+
+	int32 First = Samples.AddDefaulted(NumSamples);
+	for (int32 i = 0; i < NumSamples; i++)
+	{
+		FVehicleTelemetrySample& Sample = Samples[First + i];
+		Sample.Time = Time[i];
+		Sample.VehicleId = VehicleId[i];
+		Sample.Speed = FloatColumns[0][i];
+		Sample.Throttle = FloatColumns[1][i];
+		Sample.Angle = FloatColumns[2][i];
+		Sample.ObstacleDistance = FloatColumns[3][i];
+		for (int32 Wheel = 0; Wheel < 4; Wheel++)
+		{
+			Sample.SuspensionCompression[Wheel] = FloatColumns[4 + Wheel][i];
+		}
+		Sample.Flags = Flags[i];
+	}
+	return true;
+}
@@ -0,0 +1,206 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "Containers/CircularQueue.h"
+#include <atomic>
+
+class FRunnableThread;
+class FArchive;
+
+/** Bit flags packed into FVehicleTelemetrySample::Flags */
+enum EVehicleTelemetryFlags : uint8
+{
+	VTF_Drifting	= 1 << 0,
+	VTF_Handbraking	= 1 << 1,
+	VTF_Blocked		= 1 << 2,
+	VTF_Grounded	= 1 << 3,
+	VTF_AI			= 1 << 4,
+};
+
+/** One fixed-size telemetry record for a single vehicle at a single point in time */
+struct FVehicleTelemetrySample
+{
+	/** World time the sample was taken at */
+	double Time = 0.0;
+	/** Telemetry id of the vehicle, see FVehicleTelemetry::RegisterVehicle */
+	uint32 VehicleId = 0;
+	float Speed = 0.0f;
+	float Throttle = 0.0f;
+	/** Last steering angle requested from the movement component */
+	float Angle = 0.0f;
+	float ObstacleDistance = 0.0f;
+	/** Suspension compression per wheel (FL, FR, RL, RR), 0 fully compressed, 1 not touching the ground */
+	float SuspensionCompression[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	/** Combination of EVehicleTelemetryFlags */
+	uint8 Flags = 0;
+};
+
+/**
+ * Telemetry channel for vehicles.
+ * Producers push samples into a lock-free ring buffer owned by their thread and never block,
+ * if the ring is full the sample is dropped and counted. A background thread drains the rings
+ * into a compressed columnar file that can be read back with FVehicleTelemetryReader.
+ *
+ * Controlled from the console:
+ *	Vehicle.Telemetry.Start [FileName]
+ *	Vehicle.Telemetry.Stop
+ *	vehicle.Telemetry.SampleRate <Hz>
+ *	vehicle.Telemetry.Filter <Name1,Name2,...>
+ */
+class RL_POSTPERSON_API FVehicleTelemetry : public FRunnable
+{
+public:
+	/** Get the telemetry singleton */
+	static FVehicleTelemetry& Get();
+
+	virtual ~FVehicleTelemetry();
+
+	/**
+	 * Start recording to a file, does nothing if already recording
+	 * @param FileName Path of the file to write, relative paths are placed in the project Saved/Telemetry folder
+	 * @return true if the file was opened
+	*/
+	bool StartRecording(const FString& FileName);
+	/** Stop recording, flushes every pending sample and closes the file */
+	void StopRecording();
+	/** Check if samples are being recorded */
+	bool IsRecording() const { return bIsRecording.load(std::memory_order_relaxed); }
+
+	/**
+	 * Register a vehicle so its name can be found in the analysis tool
+	 * @param VehicleName Display name of the vehicle
+	 * @return Id to use for the vehicle samples, never reused by another vehicle
+	*/
+	uint32 RegisterVehicle(const FString& VehicleName);
+	/**
+	 * Unregister a vehicle that will not push any more samples
+	 * @param VehicleId Id returned by RegisterVehicle
+	*/
+	void UnregisterVehicle(uint32 VehicleId);
+	/**
+	 * Push a sample into the ring buffer of the calling thread, never blocks
+	 * @return false if the ring buffer was full and the sample was dropped
+	*/
+	bool Push(const FVehicleTelemetrySample& Sample);
+
+	/** Check if a vehicle passes the vehicle.Telemetry.Filter console variable */
+	static bool PassesFilter(const FString& VehicleName);
+	/** Serial that changes every time the filter changes, used by producers to cache PassesFilter */
+	static uint32 GetFilterSerial();
+	/** Minimum time between samples of a single vehicle, 0 to sample every frame */
+	static float GetSampleInterval();
+
+	/** Amount of samples dropped in the current or last recording because a ring buffer was full */
+	uint64 GetDroppedSamples() const;
+
+	// FRunnable
+	virtual uint32 Run() override;
+	virtual void Stop() override;
+
+	/** File magic and version of the telemetry file */
+	static constexpr uint32 FileMagic = 0x4D4C5456; // 'VTLM'
+	static constexpr uint32 FileVersion = 2;
+	/** Maximum amount of samples in a single samples chunk */
+	static constexpr int32 SamplesPerChunk = 8192;
+
+	/** Chunk types stored in the telemetry file */
+	enum class EChunk : uint8
+	{
+		Names = 1,
+		Samples = 2,
+	};
+
+	/** Columns stored in a samples chunk, in file order */
+	enum class EColumn : uint8
+	{
+		Time,
+		VehicleId,
+		Speed,
+		Throttle,
+		Angle,
+		ObstacleDistance,
+		Suspension0,
+		Suspension1,
+		Suspension2,
+		Suspension3,
+		Flags,
+		Count
+	};
+
+private:
+	FVehicleTelemetry();
+
+	/** Single producer / single consumer ring buffer owned by one producer thread */
+	struct FThreadRing
+	{
+		FThreadRing() : Queue(RingCapacity) {}
+
+		TCircularQueue<FVehicleTelemetrySample> Queue;
+		/** Only written by the producer thread */
+		std::atomic<uint64> Dropped{ 0 };
+		/** Next ring in the lock-free list of rings */
+		FThreadRing* Next = nullptr;
+	};
+
+	/** Get the ring of the calling thread, creating it the first time */
+	FThreadRing* GetThreadRing();
+	/** Samples dropped by every ring since the rings were created */
+	uint64 GetTotalDroppedSamples() const;
+	/** Move every pending sample into the column staging buffers, returns the amount of samples drained */
+	int32 DrainRings();
+	/** Write pending vehicle names and staged samples to the file */
+	void FlushToFile();
+	void WriteNames();
+	void WriteSamples();
+
+	static constexpr uint32 RingCapacity = 4096;
+
+	/** Head of the lock-free list of every ring ever created, rings are never freed */
+	std::atomic<FThreadRing*> RingHead{ nullptr };
+	std::atomic<bool> bIsRecording{ false };
+	std::atomic<bool> bStopRequested{ false };
+	/** Total dropped samples when the current recording started */
+	uint64 DroppedAtStart = 0;
+
+	FRunnableThread* WriterThread = nullptr;
+	FEvent* WakeEvent = nullptr;
+	/** Only accessed by the writer thread while recording */
+	FArchive* FileWriter = nullptr;
+
+	/** Names of the registered vehicles and the names not yet written to the file, guarded by NamesLock */
+	FCriticalSection NamesLock;
+	TMap<uint32, FString> VehicleNames;
+	TArray<TPair<uint32, FString>> PendingNames;
+	uint32 NextVehicleId = 1;
+
+	/** Staged samples split per column, only accessed by the writer thread */
+	TArray<double> TimeColumn;
+	TArray<uint32> VehicleIdColumn;
+	TArray<float> FloatColumns[8];
+	TArray<uint8> FlagsColumn;
+};
+
+/** Loads a telemetry file written by FVehicleTelemetry for offline analysis */
+class RL_POSTPERSON_API FVehicleTelemetryReader
+{
+public:
+	/**
+	 * Load every sample in a telemetry file
+	 * @param FileName File to read
+	 * @return false if the file could not be read or is not a telemetry file
+	*/
+	bool Load(const FString& FileName);
+
+	/** Every sample in the file, in the order they were drained */
+	TArray<FVehicleTelemetrySample> Samples;
+	/** Names of the vehicles registered while recording */
+	TMap<uint32, FString> VehicleNames;
+	/** Samples dropped by the producers while recording */
+	uint64 DroppedSamples = 0;
+
+private:
+	bool ReadSamples(FArchive& Ar);
+};
@@ -0,0 +1,111 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "VehicleTelemetryCommandlet.h"
+#include "VehicleTelemetry.h"
+#include "Misc/FileHelper.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogVehicleTelemetryCommandlet, Log, All);
+
+UVehicleTelemetryCommandlet::UVehicleTelemetryCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UVehicleTelemetryCommandlet::Main(const FString& Params)
+{
+	FString FileName;
+	FString VehicleFilter;
+	FString CSVFileName;
+	FParse::Value(*Params, TEXT("File="), FileName);
+	FParse::Value(*Params, TEXT("Vehicle="), VehicleFilter);
+	FParse::Value(*Params, TEXT("CSV="), CSVFileName);
+
+	FVehicleTelemetryReader Reader;
+	if (FileName.IsEmpty() || !Reader.Load(FileName))
+	{
+		UE_LOG(LogVehicleTelemetryCommandlet, Error, TEXT("Could not load telemetry file '%s'"), *FileName);
+		return 1;
+	}
+
+	/** Summary of all the samples of a single vehicle */
+	struct FVehicleSummary
+	{
+		int32 NumSamples = 0;
+		double FirstTime = 0.0;
+		double LastTime = 0.0;
+		float MaxSpeed = 0.0f;
+		double SpeedSum = 0.0;
+		int32 BlockedSamples = 0;
+		int32 DriftingSamples = 0;
+		float MinObstacleDistance = TNumericLimits<float>::Max();
+	};
+	TMap<uint32, FVehicleSummary> Summaries;
+
+	TArray<FString> CSVLines;
+	CSVLines.Add(TEXT("Time,Vehicle,Speed,Throttle,Angle,ObstacleDistance,SuspensionFL,SuspensionFR,SuspensionRL,SuspensionRR,Drifting,Handbraking,Blocked,Grounded,AI"));
+
+	for (const FVehicleTelemetrySample& Sample : Reader.Samples)
+	{
+		const FString VehicleName = Reader.VehicleNames.FindRef(Sample.VehicleId);
+		if (!VehicleFilter.IsEmpty() && VehicleName != VehicleFilter)
+		{
+			continue;
+		}
+
+		FVehicleSummary& Summary = Summaries.FindOrAdd(Sample.VehicleId);
+		if (Summary.NumSamples == 0)
+		{
+			Summary.FirstTime = Sample.Time;
+		}
+		Summary.NumSamples++;
+		Summary.LastTime = Sample.Time;
+		Summary.MaxSpeed = FMath::Max(Summary.MaxSpeed, Sample.Speed);
+		Summary.SpeedSum += Sample.Speed;
+		if (Sample.Flags & VTF_Blocked)
+		{
+			Summary.BlockedSamples++;
+			Summary.MinObstacleDistance = FMath::Min(Summary.MinObstacleDistance, Sample.ObstacleDistance);
+		}
+		if (Sample.Flags & VTF_Drifting)
+		{
+			Summary.DriftingSamples++;
+		}
+
+		if (!CSVFileName.IsEmpty())
+		{
+			CSVLines.Add(FString::Printf(TEXT("%f,%s,%f,%f,%f,%f,%f,%f,%f,%f,%d,%d,%d,%d,%d"),
+				Sample.Time, *VehicleName, Sample.Speed, Sample.Throttle, Sample.Angle, Sample.ObstacleDistance,
+				Sample.SuspensionCompression[0], Sample.SuspensionCompression[1], Sample.SuspensionCompression[2], Sample.SuspensionCompression[3],
+				(Sample.Flags & VTF_Drifting) ? 1 : 0, (Sample.Flags & VTF_Handbraking) ? 1 : 0, (Sample.Flags & VTF_Blocked) ? 1 : 0,
+				(Sample.Flags & VTF_Grounded) ? 1 : 0, (Sample.Flags & VTF_AI) ? 1 : 0));
+		}
+	}
+
+	UE_LOG(LogVehicleTelemetryCommandlet, Display, TEXT("%d samples, %d vehicles, %llu samples dropped while recording"), Reader.Samples.Num(), Reader.VehicleNames.Num(), Reader.DroppedSamples);
+
+	for (const TPair<uint32, FVehicleSummary>& Pair : Summaries)
+	{
+		const FVehicleSummary& Summary = Pair.Value;
+		UE_LOG(LogVehicleTelemetryCommandlet, Display, TEXT("%s: %d samples over %.2fs, avg speed %.1f, max speed %.1f, blocked %.1f%%, drifting %.1f%%, min obstacle distance %.1f"),
+			*Reader.VehicleNames.FindRef(Pair.Key),
+			Summary.NumSamples,
+			Summary.LastTime - Summary.FirstTime,
+			Summary.SpeedSum / Summary.NumSamples,
+			Summary.MaxSpeed,
+			100.0f * Summary.BlockedSamples / Summary.NumSamples,
+			100.0f * Summary.DriftingSamples / Summary.NumSamples,
+			Summary.BlockedSamples > 0 ? Summary.MinObstacleDistance : 0.0f);
+	}
+
+	if (!CSVFileName.IsEmpty() && !FFileHelper::SaveStringArrayToFile(CSVLines, *CSVFileName))
+	{
+		UE_LOG(LogVehicleTelemetryCommandlet, Error, TEXT("Could not write CSV file '%s'"), *CSVFileName);
+		return 1;
+	}
+
+	return 0;
+}
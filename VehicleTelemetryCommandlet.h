@@ -0,0 +1,24 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "VehicleTelemetryCommandlet.generated.h"
+
+/**
+ * Offline analysis of a vehicle telemetry file.
+ * Prints a per vehicle summary and optionally exports the samples as CSV.
+ *
+ * Usage: -run=VehicleTelemetry -File=<Path> [-Vehicle=<Name>] [-CSV=<Path>]
+ */
+UCLASS()
+class RL_POSTPERSON_API UVehicleTelemetryCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UVehicleTelemetryCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};